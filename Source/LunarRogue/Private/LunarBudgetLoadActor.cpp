@@ -0,0 +1,32 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "LunarBudgetLoadActor.h"
+#include "LunarFrameBudgetSubsystem.h"
+
+ALunarBudgetLoadActor::ALunarBudgetLoadActor()
+{
+	PrimaryActorTick.bCanEverTick = true;
+}
+
+void ALunarBudgetLoadActor::BeginPlay()
+{
+	Super::BeginPlay();
+
+	if (ULunarFrameBudgetSubsystem* Budget = GetWorld()->GetSubsystem<ULunarFrameBudgetSubsystem>())
+	{
+		Budget->RegisterBudgetedObject(this, Category);
+	}
+}
+
+void ALunarBudgetLoadActor::Tick(float DeltaSeconds)
+{
+	Super::Tick(DeltaSeconds);
+
+#if !UE_BUILD_SHIPPING
+	const double EndTime = FPlatformTime::Seconds() + WorkMicroseconds / 1000000.0;
+	while (FPlatformTime::Seconds() < EndTime)
+	{
+	}
+#endif
+}
@@ -4,8 +4,42 @@
 #include "LunarCharacterMovementComponent.h"
 #include "GameFramework/Character.h"
 #include "LunarTypes.h"
+#include "LunarFrameBudgetSubsystem.h"
 #include "EngineGlobals.h"
 
+void ULunarCharacterMovementComponent::BeginPlay()
+{
+	Super::BeginPlay();
+
+	BudgetSubsystem = GetWorld()->GetSubsystem<ULunarFrameBudgetSubsystem>();
+	if (BudgetSubsystem.IsValid())
+	{
+		BudgetSubsystem->RegisterMovement(this);
+	}
+}
+
+void ULunarCharacterMovementComponent::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	if (BudgetSubsystem.IsValid())
+	{
+		BudgetSubsystem->UnregisterMovement(this);
+	}
+	BudgetSubsystem.Reset();
+
+	Super::EndPlay(EndPlayReason);
+}
+
+void ULunarCharacterMovementComponent::TickComponent(float DeltaTime, enum ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction)
+{
+	const uint64 StartCycles = FPlatformTime::Cycles64();
+	Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
+
+	if (BudgetSubsystem.IsValid())
+	{
+		BudgetSubsystem->AddMovementCost(this, FPlatformTime::ToSeconds64(FPlatformTime::Cycles64() - StartCycles));
+	}
+}
+
 bool ULunarCharacterMovementComponent::IsWalkable(const FHitResult& Hit) const
 {
     if (!IsSliding())
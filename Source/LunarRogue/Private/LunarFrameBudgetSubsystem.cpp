@@ -0,0 +1,555 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "LunarFrameBudgetSubsystem.h"
+#include "LunarBudgetLoadActor.h"
+#include "LunarCharacterMovementComponent.h"
+#include "AIController.h"
+#include "BrainComponent.h"
+#include "EngineUtils.h"
+#include "GameFramework/Pawn.h"
+#include "GameFramework/ProjectileMovementComponent.h"
+#include "HAL/IConsoleManager.h"
+
+DEFINE_LOG_CATEGORY(LogLunarBudget);
+
+static FString BudgetCategoryName(ELunarBudgetCategory Category)
+{
+	return UEnum::GetDisplayValueAsText(Category).ToString();
+}
+
+#if !UE_BUILD_SHIPPING
+static void RunBudgetLoadTest(const TArray<FString>& Args, UWorld* World)
+{
+	if (!World)
+	{
+		return;
+	}
+
+	for (TActorIterator<ALunarBudgetLoadActor> It(World); It; ++It)
+	{
+		It->Destroy();
+	}
+
+	const int32 Count = Args.Num() > 0 ? FCString::Atoi(*Args[0]) : 0;
+	const float WorkMicroseconds = Args.Num() > 1 ? FCString::Atof(*Args[1]) : 50.f;
+	ELunarBudgetCategory Category = ELunarBudgetCategory::AI;
+	if (Args.Num() > 2)
+	{
+		for (int32 Index = 0; Index < (int32)ELunarBudgetCategory::MAX; Index++)
+		{
+			if (BudgetCategoryName((ELunarBudgetCategory)Index).Equals(Args[2], ESearchCase::IgnoreCase))
+			{
+				Category = (ELunarBudgetCategory)Index;
+			}
+		}
+	}
+
+	for (int32 Index = 0; Index < Count; Index++)
+	{
+		ALunarBudgetLoadActor* LoadActor = World->SpawnActorDeferred<ALunarBudgetLoadActor>(ALunarBudgetLoadActor::StaticClass(), FTransform::Identity);
+		if (!LoadActor)
+		{
+			continue;
+		}
+		LoadActor->WorkMicroseconds = WorkMicroseconds;
+		LoadActor->Category = Category;
+		LoadActor->FinishSpawning(FTransform::Identity);
+	}
+
+	UE_LOG(LogLunarBudget, Log, TEXT("Load test: %d actors burning %.0f us each in %s (%.2f ms per frame unbudgeted)"),
+		Count, WorkMicroseconds, *BudgetCategoryName(Category), Count * WorkMicroseconds / 1000.f);
+}
+
+static FAutoConsoleCommandWithWorldAndArgs LunarBudgetLoadTestCommand(
+	TEXT("Lunar.Budget.LoadTest"),
+	TEXT("Lunar.Budget.LoadTest <Count> [WorkMicroseconds=50] [Category=AI]: spawns actors that burn game-thread time every tick. A count of 0 removes them."),
+	FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&RunBudgetLoadTest));
+
+static FAutoConsoleCommandWithWorld LunarBudgetStatusCommand(
+	TEXT("Lunar.Budget.Status"),
+	TEXT("Logs the frame budget level and smoothed cost of every category."),
+	FConsoleCommandWithWorldDelegate::CreateLambda([](UWorld* World)
+	{
+		if (const ULunarFrameBudgetSubsystem* Budget = World ? World->GetSubsystem<ULunarFrameBudgetSubsystem>() : nullptr)
+		{
+			Budget->LogStatus();
+		}
+	}));
+#endif
+
+bool ULunarFrameBudgetSubsystem::DoesSupportWorldType(const EWorldType::Type WorldType) const
+{
+	return WorldType == EWorldType::Game || WorldType == EWorldType::PIE;
+}
+
+TStatId ULunarFrameBudgetSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(ULunarFrameBudgetSubsystem, STATGROUP_Tickables);
+}
+
+void ULunarFrameBudgetSubsystem::Initialize(FSubsystemCollectionBase& Collection)
+{
+	Super::Initialize(Collection);
+
+	MaxBudgetLevel = FMath::Clamp(MaxBudgetLevel, 0, MaxSupportedBudgetLevel);
+	ActorSpawnedHandle = GetWorld()->AddOnActorSpawnedHandler(FOnActorSpawned::FDelegate::CreateUObject(this, &ULunarFrameBudgetSubsystem::HandleActorSpawned));
+}
+
+void ULunarFrameBudgetSubsystem::OnWorldBeginPlay(UWorld& InWorld)
+{
+	Super::OnWorldBeginPlay(InWorld);
+
+	// actors loaded with the level never go through the spawn handler
+	for (TActorIterator<AActor> It(&InWorld); It; ++It)
+	{
+		HandleActorSpawned(*It);
+	}
+}
+
+void ULunarFrameBudgetSubsystem::HandleActorSpawned(AActor* Actor)
+{
+	if (!Actor)
+	{
+		return;
+	}
+
+	if (Actor->FindComponentByClass<UProjectileMovementComponent>())
+	{
+		RegisterIfTicking(Actor, ELunarBudgetCategory::Projectiles);
+	}
+	else if (const APawn* Pawn = Cast<APawn>(Actor))
+	{
+		// spawned pawns are possessed by AutoPossessAI before this runs, so the controller is already there
+		if (AAIController* Controller = Cast<AAIController>(Pawn->GetController()))
+		{
+			RegisterIfTicking(Actor, ELunarBudgetCategory::AI);
+			RegisterIfTicking(Controller, ELunarBudgetCategory::AI);
+			RegisterIfTicking(Controller->BrainComponent, ELunarBudgetCategory::AI);
+		}
+	}
+}
+
+void ULunarFrameBudgetSubsystem::RegisterIfTicking(UObject* Object, ELunarBudgetCategory Category)
+{
+	// most actors never tick, skip them quietly rather than warn for every fireball
+	const AActor* Actor = Cast<AActor>(Object);
+	const UActorComponent* Component = Cast<UActorComponent>(Object);
+	if ((Actor && Actor->PrimaryActorTick.bCanEverTick) || (Component && Component->PrimaryComponentTick.bCanEverTick))
+	{
+		RegisterBudgetedObject(Object, Category);
+	}
+}
+
+void ULunarFrameBudgetSubsystem::Deinitialize()
+{
+	GetWorld()->RemoveOnActorSpawnedHandler(ActorSpawnedHandle);
+
+	for (FCategoryState& State : Categories)
+	{
+		for (const FBudgetedEntry& Entry : State.Entries)
+		{
+			RestoreEngineTick(Entry);
+		}
+		State.Entries.Empty();
+		State.Level = 0;
+	}
+
+	// every level is 0 now, so this hands the saved movement settings back
+	ApplyMovementLevels();
+	MovementEntries.Empty();
+
+	Super::Deinitialize();
+}
+
+void ULunarFrameBudgetSubsystem::Tick(float DeltaTime)
+{
+	Super::Tick(DeltaTime);
+
+	if (!bEnabled)
+	{
+		for (int32 Index = 0; Index < (int32)ELunarBudgetCategory::MAX; Index++)
+		{
+			if (Categories[Index].Level > 0)
+			{
+				UE_LOG(LogLunarBudget, Log, TEXT("Budget disabled: restoring %s to level 0"), *BudgetCategoryName((ELunarBudgetCategory)Index));
+				Categories[Index].Level = 0;
+			}
+		}
+	}
+
+	ApplyMovementLevels();
+
+	for (int32 Index = 0; Index < (int32)ELunarBudgetCategory::MAX; Index++)
+	{
+		TickBudgetedEntries(Categories[Index]);
+	}
+
+	// movement reported its cost while the tick groups ran, the rest was measured just now.
+	// The smoothing is time based so it settles just as fast on a host running at 20 fps as at 120.
+	const double Alpha = 1.0 - FMath::Exp(-DeltaTime / FMath::Max(SmoothingTime, UE_KINDA_SMALL_NUMBER));
+	SmoothedFrameTime = SmoothedFrameTime > 0 ? FMath::Lerp(SmoothedFrameTime, (double)DeltaTime, Alpha) : DeltaTime;
+	SmoothedTotal = 0;
+	for (FCategoryState& State : Categories)
+	{
+		State.SmoothedCost = FMath::Lerp(State.SmoothedCost, State.FrameCost, Alpha);
+		State.SmoothedThrottleableCost = FMath::Lerp(State.SmoothedThrottleableCost, State.FrameThrottleableCost, Alpha);
+		State.FrameCost = 0;
+		State.FrameThrottleableCost = 0;
+		SmoothedTotal += State.SmoothedCost;
+	}
+
+	// don't judge a level change until the smoothed cost has had time to catch up with it (99% after 5 time constants)
+	TimeSinceDecision += DeltaTime;
+	if (bEnabled && TimeSinceDecision >= FMath::Max(DecisionInterval, 5.f * SmoothingTime))
+	{
+		Evaluate();
+	}
+}
+
+void ULunarFrameBudgetSubsystem::TickBudgetedEntries(FCategoryState& State)
+{
+	State.Entries.RemoveAll([](const FBudgetedEntry& Entry) { return !Entry.Object.IsValid(); });
+
+	// Blueprint turns tick back on routinely. Take it over again so the engine doesn't tick it next frame as well,
+	// at most the engine tick that already ran this frame slips past the measurement.
+	for (FBudgetedEntry& Entry : State.Entries)
+	{
+		if (AActor* Actor = Cast<AActor>(Entry.Object.Get()))
+		{
+			if (Actor->IsActorTickEnabled())
+			{
+				Entry.bTickEnabled = true;
+				Actor->SetActorTickEnabled(false);
+			}
+		}
+		else if (UActorComponent* Component = Cast<UActorComponent>(Entry.Object.Get()))
+		{
+			if (Component->IsComponentTickEnabled())
+			{
+				Entry.bTickEnabled = true;
+				Component->SetComponentTickEnabled(false);
+			}
+		}
+	}
+
+	// entries registered while ticking are appended past Num and wait for the next frame,
+	// entries unregistered while ticking are only cleared so the indices stay stable
+	const int32 Num = State.Entries.Num();
+	if (Num == 0)
+	{
+		return;
+	}
+
+	const int32 BatchSize = FMath::DivideAndRoundUp(Num, 1 << State.Level);
+	const double Now = GetWorld()->GetTimeSeconds();
+	const uint64 StartCycles = FPlatformTime::Cycles64();
+
+	for (int32 Offset = 0; Offset < BatchSize; Offset++)
+	{
+		const int32 Index = (State.NextEntry + Offset) % Num;
+		const float EntryDelta = Now - State.Entries[Index].LastTickTime;
+		if (!State.Entries[Index].bTickEnabled || EntryDelta <= 0.f || EntryDelta < State.Entries[Index].TickInterval)
+		{
+			continue;
+		}
+
+		UObject* Object = State.Entries[Index].Object.Get();
+		if (AActor* Actor = Cast<AActor>(Object))
+		{
+			if (!Actor->HasActorBegunPlay() || Actor->IsActorBeingDestroyed())
+			{
+				continue;
+			}
+			Actor->TickActor(EntryDelta * Actor->CustomTimeDilation, LEVELTICK_All, Actor->PrimaryActorTick);
+		}
+		else if (UActorComponent* Component = Cast<UActorComponent>(Object))
+		{
+			// the same checks the engine's component tick function makes before ticking
+			if (!Component->IsRegistered() || !Component->HasBegunPlay() || Component->IsBeingDestroyed())
+			{
+				continue;
+			}
+			const AActor* Owner = Component->GetOwner();
+			Component->TickComponent(EntryDelta * (Owner ? Owner->CustomTimeDilation : 1.f), LEVELTICK_All, &Component->PrimaryComponentTick);
+		}
+		else
+		{
+			continue;
+		}
+
+		State.Entries[Index].LastTickTime = Now;
+	}
+
+	State.NextEntry = (State.NextEntry + BatchSize) % Num;
+	const double Cost = FPlatformTime::ToSeconds64(FPlatformTime::Cycles64() - StartCycles);
+	State.FrameCost += Cost;
+	State.FrameThrottleableCost += Cost;
+}
+
+void ULunarFrameBudgetSubsystem::Evaluate()
+{
+	const double TargetSeconds = TargetSimulationMs / 1000.0;
+
+	if (SmoothedTotal > TargetSeconds)
+	{
+		// degrade whatever has the most cost we can cut and still has room to give
+		int32 Worst = INDEX_NONE;
+		for (int32 Index = 0; Index < (int32)ELunarBudgetCategory::MAX; Index++)
+		{
+			// Blueprint can still write MaxBudgetLevel after Initialize clamped it
+			if (Categories[Index].Level < FMath::Clamp(MaxBudgetLevel, 0, MaxSupportedBudgetLevel) && Categories[Index].SmoothedThrottleableCost > 0
+				&& (Worst == INDEX_NONE || Categories[Index].SmoothedThrottleableCost > Categories[Worst].SmoothedThrottleableCost))
+			{
+				Worst = Index;
+			}
+		}
+
+		if (Worst != INDEX_NONE)
+		{
+			UE_LOG(LogLunarBudget, Log, TEXT("Over budget (%.2f ms / %.2f ms): %s costs %.2f ms, raising to level %d"),
+				SmoothedTotal * 1000.0, TargetSimulationMs, *BudgetCategoryName((ELunarBudgetCategory)Worst),
+				Categories[Worst].SmoothedThrottleableCost * 1000.0, Categories[Worst].Level + 1);
+			Categories[Worst].Level++;
+			TimeSinceDecision = 0;
+		}
+	}
+	else
+	{
+		// restore the most degraded category first, ties go to the lowest value so movement comes back before the rest
+		int32 Best = INDEX_NONE;
+		for (int32 Index = 0; Index < (int32)ELunarBudgetCategory::MAX; Index++)
+		{
+			if (Categories[Index].Level > 0 && (Best == INDEX_NONE || Categories[Index].Level > Categories[Best].Level))
+			{
+				Best = Index;
+			}
+		}
+
+		// dropping a level roughly doubles the category's cost, only do it if that still fits
+		if (Best != INDEX_NONE && SmoothedTotal + Categories[Best].SmoothedThrottleableCost < TargetSeconds * RestoreThreshold)
+		{
+			UE_LOG(LogLunarBudget, Log, TEXT("Under budget (%.2f ms / %.2f ms): %s costs %.2f ms, restoring to level %d"),
+				SmoothedTotal * 1000.0, TargetSimulationMs, *BudgetCategoryName((ELunarBudgetCategory)Best),
+				Categories[Best].SmoothedThrottleableCost * 1000.0, Categories[Best].Level - 1);
+			Categories[Best].Level--;
+			TimeSinceDecision = 0;
+		}
+	}
+}
+
+void ULunarFrameBudgetSubsystem::ApplyMovementLevels()
+{
+	MovementEntries.RemoveAll([](const FMovementEntry& Entry) { return !Entry.Movement.IsValid(); });
+
+	const int32 Level = Categories[(int32)ELunarBudgetCategory::Movement].Level;
+	for (FMovementEntry& Entry : MovementEntries)
+	{
+		const int32 EntryLevel = CanThrottleMovement(Entry.Movement.Get()) ? Level : 0;
+		if (EntryLevel != Entry.AppliedLevel)
+		{
+			ApplyMovementLevel(Entry, EntryLevel);
+		}
+	}
+}
+
+bool ULunarFrameBudgetSubsystem::CanThrottleMovement(const ULunarCharacterMovementComponent* Movement)
+{
+	// players feel a lower movement tick rate immediately, and on a server their moves have to match
+	// client prediction, so only pawns nobody controls get throttled
+	const APawn* Pawn = Movement ? Movement->GetPawnOwner() : nullptr;
+	return !(Pawn && Pawn->IsPlayerControlled());
+}
+
+void ULunarFrameBudgetSubsystem::ApplyMovementLevel(FMovementEntry& Entry, int32 NewLevel) const
+{
+	ULunarCharacterMovementComponent* Movement = Entry.Movement.Get();
+	if (!Movement)
+	{
+		return;
+	}
+
+	if (Entry.AppliedLevel == 0)
+	{
+		// keep whatever gameplay set last so it comes back untouched
+		Entry.SavedMaxSimulationIterations = Movement->MaxSimulationIterations;
+		Entry.SavedTickInterval = Movement->GetComponentTickInterval();
+	}
+
+	if (NewLevel == 0)
+	{
+		Movement->MaxSimulationIterations = Entry.SavedMaxSimulationIterations;
+		Movement->SetComponentTickInterval(Entry.SavedTickInterval);
+	}
+	else
+	{
+		// the interval is counted in frames so every level really halves the work whatever the host's tick rate,
+		// half a frame short of 2^level so frame time jitter can't push the tick a frame later
+		const float FrameTime = SmoothedFrameTime;
+		const float TickInterval = FMath::Max(Entry.SavedTickInterval, ((1 << NewLevel) - 0.5f) * FrameTime);
+
+		// a longer tick still has to be substepped at MaxSimulationTimeStep, one big step tunnels and throws off
+		// the launch and ledge checks in PhysSliding. The tick can land up to a frame after the interval.
+		const int32 NeededIterations = FMath::CeilToInt((TickInterval + FrameTime) / FMath::Max(Movement->MaxSimulationTimeStep, UE_KINDA_SMALL_NUMBER));
+		Movement->MaxSimulationIterations = FMath::Max(Entry.SavedMaxSimulationIterations, NeededIterations);
+		Movement->SetComponentTickInterval(TickInterval);
+	}
+
+	Entry.AppliedLevel = NewLevel;
+}
+
+void ULunarFrameBudgetSubsystem::RegisterMovement(ULunarCharacterMovementComponent* Movement)
+{
+	if (!Movement || MovementEntries.ContainsByPredicate([Movement](const FMovementEntry& Entry) { return Entry.Movement == Movement; }))
+	{
+		return;
+	}
+
+	FMovementEntry& Entry = MovementEntries.AddDefaulted_GetRef();
+	Entry.Movement = Movement;
+}
+
+void ULunarFrameBudgetSubsystem::UnregisterMovement(ULunarCharacterMovementComponent* Movement)
+{
+	const int32 Index = MovementEntries.IndexOfByPredicate([Movement](const FMovementEntry& Entry) { return Entry.Movement == Movement; });
+	if (Index == INDEX_NONE)
+	{
+		return;
+	}
+
+	if (MovementEntries[Index].AppliedLevel != 0)
+	{
+		ApplyMovementLevel(MovementEntries[Index], 0);
+	}
+	MovementEntries.RemoveAt(Index);
+}
+
+void ULunarFrameBudgetSubsystem::RegisterBudgetedObject(UObject* Object, ELunarBudgetCategory Category)
+{
+	if (!Object || Category == ELunarBudgetCategory::MAX)
+	{
+		return;
+	}
+
+	if (ULunarCharacterMovementComponent* Movement = Cast<ULunarCharacterMovementComponent>(Object))
+	{
+		RegisterMovement(Movement);
+		return;
+	}
+
+	UnregisterBudgetedObject(Object);
+
+	FBudgetedEntry Entry;
+	Entry.Object = Object;
+	Entry.LastTickTime = GetWorld()->GetTimeSeconds();
+
+	if (AActor* Actor = Cast<AActor>(Object))
+	{
+		if (!Actor->PrimaryActorTick.bCanEverTick)
+		{
+			UE_LOG(LogLunarBudget, Warning, TEXT("%s never ticks, nothing to budget"), *Actor->GetName());
+			return;
+		}
+		Entry.TickInterval = Actor->GetActorTickInterval();
+		Entry.bTickEnabled = Actor->IsActorTickEnabled();
+		Actor->SetActorTickEnabled(false);
+	}
+	else if (UActorComponent* Component = Cast<UActorComponent>(Object))
+	{
+		if (!Component->PrimaryComponentTick.bCanEverTick)
+		{
+			UE_LOG(LogLunarBudget, Warning, TEXT("%s never ticks, nothing to budget"), *Component->GetName());
+			return;
+		}
+		Entry.TickInterval = Component->GetComponentTickInterval();
+		Entry.bTickEnabled = Component->IsComponentTickEnabled();
+		Component->SetComponentTickEnabled(false);
+	}
+	else
+	{
+		UE_LOG(LogLunarBudget, Warning, TEXT("%s is not an actor or component, nothing to budget"), *Object->GetName());
+		return;
+	}
+
+	Categories[(int32)Category].Entries.Add(Entry);
+}
+
+void ULunarFrameBudgetSubsystem::UnregisterBudgetedObject(UObject* Object)
+{
+	if (ULunarCharacterMovementComponent* Movement = Cast<ULunarCharacterMovementComponent>(Object))
+	{
+		UnregisterMovement(Movement);
+		return;
+	}
+
+	for (FCategoryState& State : Categories)
+	{
+		for (FBudgetedEntry& Entry : State.Entries)
+		{
+			if (Entry.Object == Object)
+			{
+				RestoreEngineTick(Entry);
+				// cleared rather than removed, this can run from inside TickBudgetedEntries
+				Entry.Object = nullptr;
+			}
+		}
+	}
+}
+
+void ULunarFrameBudgetSubsystem::RestoreEngineTick(const FBudgetedEntry& Entry)
+{
+	if (AActor* Actor = Cast<AActor>(Entry.Object.Get()))
+	{
+		Actor->SetActorTickEnabled(Entry.bTickEnabled);
+	}
+	else if (UActorComponent* Component = Cast<UActorComponent>(Entry.Object.Get()))
+	{
+		Component->SetComponentTickEnabled(Entry.bTickEnabled);
+	}
+}
+
+void ULunarFrameBudgetSubsystem::AddCost(ELunarBudgetCategory Category, double Seconds)
+{
+	if (Category != ELunarBudgetCategory::MAX)
+	{
+		Categories[(int32)Category].FrameCost += Seconds;
+		Categories[(int32)Category].FrameThrottleableCost += Seconds;
+	}
+}
+
+void ULunarFrameBudgetSubsystem::AddMovementCost(const ULunarCharacterMovementComponent* Movement, double Seconds)
+{
+	FCategoryState& State = Categories[(int32)ELunarBudgetCategory::Movement];
+	State.FrameCost += Seconds;
+	if (CanThrottleMovement(Movement))
+	{
+		State.FrameThrottleableCost += Seconds;
+	}
+}
+
+int32 ULunarFrameBudgetSubsystem::GetBudgetLevel(ELunarBudgetCategory Category) const
+{
+	return Category != ELunarBudgetCategory::MAX ? Categories[(int32)Category].Level : 0;
+}
+
+float ULunarFrameBudgetSubsystem::GetSmoothedTotalMs() const
+{
+	return SmoothedTotal * 1000.0;
+}
+
+float ULunarFrameBudgetSubsystem::GetSmoothedCostMs(ELunarBudgetCategory Category) const
+{
+	return Category != ELunarBudgetCategory::MAX ? Categories[(int32)Category].SmoothedCost * 1000.0 : 0.f;
+}
+
+void ULunarFrameBudgetSubsystem::LogStatus() const
+{
+	UE_LOG(LogLunarBudget, Log, TEXT("Simulation cost %.2f ms / %.2f ms target%s"),
+		SmoothedTotal * 1000.0, TargetSimulationMs, bEnabled ? TEXT("") : TEXT(" (disabled)"));
+	for (int32 Index = 0; Index < (int32)ELunarBudgetCategory::MAX; Index++)
+	{
+		const int32 Count = Categories[Index].Entries.Num() + (Index == (int32)ELunarBudgetCategory::Movement ? MovementEntries.Num() : 0);
+		UE_LOG(LogLunarBudget, Log, TEXT("  %-12s level %d  %6.2f ms  %d registered"),
+			*BudgetCategoryName((ELunarBudgetCategory)Index), Categories[Index].Level, Categories[Index].SmoothedCost * 1000.0, Count);
+	}
+}
@@ -0,0 +1,155 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "Misc/AutomationTest.h"
+#include "Engine/Engine.h"
+#include "Engine/World.h"
+#include "EngineUtils.h"
+#include "GameFramework/WorldSettings.h"
+#include "LunarBudgetLoadActor.h"
+#include "LunarFrameBudgetSubsystem.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+// All of these run headless, e.g. LunarRogue -nullrhi -unattended -ExecCmds="Automation RunTests LunarRogue.FrameBudget; Quit"
+namespace LunarFrameBudgetTest
+{
+	// a bare game world with the budget set up the same way whatever the ini says
+	struct FTestWorld
+	{
+		UWorld* World = nullptr;
+		ULunarFrameBudgetSubsystem* Budget = nullptr;
+
+		FTestWorld()
+		{
+			World = UWorld::CreateWorld(EWorldType::Game, false);
+			FWorldContext& WorldContext = GEngine->CreateNewWorldContext(EWorldType::Game);
+			WorldContext.SetCurrentWorld(World);
+			World->InitializeActorsForPlay(FURL());
+			World->GetWorldSettings()->NotifyBeginPlay();
+
+			Budget = World->GetSubsystem<ULunarFrameBudgetSubsystem>();
+			if (Budget)
+			{
+				Budget->bEnabled = true;
+				Budget->TargetSimulationMs = 8.f;
+				Budget->RestoreThreshold = 0.9f;
+				Budget->DecisionInterval = 0.5f;
+				Budget->SmoothingTime = 0.1f;
+				Budget->MaxBudgetLevel = 3;
+			}
+		}
+
+		~FTestWorld()
+		{
+			GEngine->DestroyWorldContext(World);
+			World->DestroyWorld(false);
+		}
+
+		// 240 x 50 us is 12 ms of AI against the 8 ms target. Level 1 halves that to 6 ms, and going back
+		// to level 0 would need 12 ms again, so the budget should settle on level 1.
+		void SpawnLoad()
+		{
+			for (int32 Index = 0; Index < 240; Index++)
+			{
+				ALunarBudgetLoadActor* LoadActor = World->SpawnActorDeferred<ALunarBudgetLoadActor>(ALunarBudgetLoadActor::StaticClass(), FTransform::Identity);
+				if (LoadActor)
+				{
+					LoadActor->WorkMicroseconds = 50;
+					LoadActor->Category = ELunarBudgetCategory::AI;
+					LoadActor->FinishSpawning(FTransform::Identity);
+				}
+			}
+		}
+
+		void ClearLoad()
+		{
+			for (TActorIterator<ALunarBudgetLoadActor> It(World); It; ++It)
+			{
+				It->Destroy();
+			}
+		}
+
+		// a slow headless host running at 30 fps
+		void Simulate(float Seconds)
+		{
+			for (float Elapsed = 0; Elapsed < Seconds; Elapsed += 1.f / 30.f)
+			{
+				World->Tick(LEVELTICK_All, 1.f / 30.f);
+			}
+		}
+	};
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FLunarFrameBudgetHoldsTargetTest, "LunarRogue.FrameBudget.HoldsTargetUnderLoad",
+	EAutomationTestFlags_ApplicationContextMask | EAutomationTestFlags::ProductFilter)
+
+bool FLunarFrameBudgetHoldsTargetTest::RunTest(const FString& Parameters)
+{
+	LunarFrameBudgetTest::FTestWorld TestWorld;
+	if (!TestNotNull(TEXT("Frame budget subsystem"), TestWorld.Budget))
+	{
+		return false;
+	}
+
+	TestWorld.SpawnLoad();
+	TestWorld.Simulate(4.f);
+
+	// the busy-wait runs on wall-clock time, a contended machine can push it one level further
+	const int32 Level = TestWorld.Budget->GetBudgetLevel(ELunarBudgetCategory::AI);
+	TestTrue(FString::Printf(TEXT("AI budget level %d is 1 or 2"), Level), Level >= 1 && Level <= 2);
+	TestTrue(FString::Printf(TEXT("Smoothed total %.2f ms holds the %.2f ms target"), TestWorld.Budget->GetSmoothedTotalMs(), TestWorld.Budget->TargetSimulationMs),
+		TestWorld.Budget->GetSmoothedTotalMs() <= TestWorld.Budget->TargetSimulationMs);
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FLunarFrameBudgetRestoresTest, "LunarRogue.FrameBudget.RestoresWhenLoadDrops",
+	EAutomationTestFlags_ApplicationContextMask | EAutomationTestFlags::ProductFilter)
+
+bool FLunarFrameBudgetRestoresTest::RunTest(const FString& Parameters)
+{
+	LunarFrameBudgetTest::FTestWorld TestWorld;
+	if (!TestNotNull(TEXT("Frame budget subsystem"), TestWorld.Budget))
+	{
+		return false;
+	}
+
+	TestWorld.SpawnLoad();
+	TestWorld.Simulate(4.f);
+	TestTrue(TEXT("AI is degraded under load"), TestWorld.Budget->GetBudgetLevel(ELunarBudgetCategory::AI) > 0);
+
+	// one level comes back per decision, four seconds is plenty for MaxBudgetLevel of them
+	TestWorld.ClearLoad();
+	TestWorld.Simulate(4.f);
+	TestEqual(TEXT("AI budget level once the load is gone"), TestWorld.Budget->GetBudgetLevel(ELunarBudgetCategory::AI), 0);
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FLunarFrameBudgetDisableTest, "LunarRogue.FrameBudget.DisableResetsLevels",
+	EAutomationTestFlags_ApplicationContextMask | EAutomationTestFlags::ProductFilter)
+
+bool FLunarFrameBudgetDisableTest::RunTest(const FString& Parameters)
+{
+	LunarFrameBudgetTest::FTestWorld TestWorld;
+	if (!TestNotNull(TEXT("Frame budget subsystem"), TestWorld.Budget))
+	{
+		return false;
+	}
+
+	TestWorld.SpawnLoad();
+	TestWorld.Simulate(4.f);
+	TestTrue(TEXT("AI is degraded under load"), TestWorld.Budget->GetBudgetLevel(ELunarBudgetCategory::AI) > 0);
+
+	// the load is still there, turning the budget off has to drop every level on the next frame anyway
+	TestWorld.Budget->bEnabled = false;
+	TestWorld.Simulate(1.f / 30.f);
+	for (int32 Index = 0; Index < (int32)ELunarBudgetCategory::MAX; Index++)
+	{
+		const ELunarBudgetCategory Category = (ELunarBudgetCategory)Index;
+		TestEqual(FString::Printf(TEXT("%s budget level while disabled"), *UEnum::GetDisplayValueAsText(Category).ToString()),
+			TestWorld.Budget->GetBudgetLevel(Category), 0);
+	}
+	return true;
+}
+
+#endif
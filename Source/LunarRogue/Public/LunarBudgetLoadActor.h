@@ -0,0 +1,30 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "GameFramework/Actor.h"
+#include "LunarTypes.h"
+#include "LunarBudgetLoadActor.generated.h"
+
+/**
+ * Burns a fixed amount of game-thread time every tick. Used by the LunarRogue.FrameBudget automation
+ * test and the Lunar.Budget.LoadTest console command to check that the frame budget holds its target.
+ * UHT can't compile a UCLASS out, so in shipping builds the class exists but its tick does nothing.
+ */
+UCLASS(NotBlueprintable)
+class LUNARROGUE_API ALunarBudgetLoadActor : public AActor
+{
+	GENERATED_BODY()
+public:
+	ALunarBudgetLoadActor();
+
+	virtual void BeginPlay() override;
+	virtual void Tick(float DeltaSeconds) override;
+
+	// properties
+	UPROPERTY(Category="Lunar Budget", EditAnywhere, BlueprintReadWrite, meta=(ClampMin="0", UIMin="0"))
+	float WorkMicroseconds = 50;
+	UPROPERTY(Category="Lunar Budget", EditAnywhere, BlueprintReadWrite)
+	ELunarBudgetCategory Category = ELunarBudgetCategory::AI;
+};
@@ -6,6 +6,8 @@
 #include "GameFramework/CharacterMovementComponent.h"
 #include "LunarCharacterMovementComponent.generated.h"
 
+class ULunarFrameBudgetSubsystem;
+
 /**
  * 
  */
@@ -45,4 +47,11 @@ public:
 	virtual bool IsWalkable(const FHitResult& Hit) const;
 	virtual float SlideAlongSurface(const FVector& Delta, float Time, const FVector& Normal, FHitResult& Hit, bool bHandleImpact) override;
 	virtual void CalcVelocity(float DeltaTime, float Friction, bool bFluid, float BrakingDeceleration);
+	virtual void BeginPlay() override;
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+	virtual void TickComponent(float DeltaTime, enum ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction) override;
+
+private:
+	// reports our tick cost and hands out MaxSimulationIterations / tick interval under load
+	TWeakObjectPtr<ULunarFrameBudgetSubsystem> BudgetSubsystem;
 };
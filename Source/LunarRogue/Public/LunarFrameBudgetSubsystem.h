@@ -0,0 +1,139 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "LunarTypes.h"
+#include "LunarFrameBudgetSubsystem.generated.h"
+
+class ULunarCharacterMovementComponent;
+
+DECLARE_LOG_CATEGORY_EXTERN(LogLunarBudget, Log, All);
+
+/**
+ * Keeps gameplay simulation inside a game-thread time budget.
+ *
+ * Every frame the cost of movement, AI and projectiles is measured. When the total runs over
+ * TargetSimulationMs the category with the most cost it can actually cut gets its budget level
+ * raised (player movement counts towards the total but is never throttled), and once there is
+ * headroom again the most degraded category is restored. Each level halves the work of a category:
+ * movement of pawns no player controls ticks every 2^level frames (with enough iterations to keep
+ * each substep at MaxSimulationTimeStep), everything else is ticked in smaller round-robin batches.
+ * Movement settings are only written when a pawn's level changes and are restored at level 0.
+ *
+ * AI and projectiles are picked up on their own when they spawn or when play begins:
+ * - Projectiles: actors with a ProjectileMovementComponent. Only the actor's own (Blueprint) tick is
+ *   budgeted, the ProjectileMovementComponent keeps ticking ahead of physics as usual.
+ * - AI: pawns controlled by an AIController at that point. The pawn's tick, the controller's tick and
+ *   the controller's BrainComponent (behavior tree) tick are budgeted. Path following, perception and
+ *   EQS are not, and neither is a pawn an AIController only possesses after it spawned.
+ * Anything else can be added with RegisterBudgetedObject.
+ *
+ * Budgeted actors and components are ticked by this subsystem instead of the engine, which is what
+ * lets their cost be measured and batched. That moves their tick out of its
+ * tick group: they run after TG_PostUpdateWork, ignore tick prerequisites and don't tick while the
+ * game is paused, even with bTickEvenWhenPaused. Only register objects whose tick doesn't care
+ * about ordering.
+ * Registering keeps the tick enabled state the object had and hands it back on unregister. An
+ * object whose tick was off is not ticked until it turns tick back on, which is picked up the next
+ * frame and handed back to the subsystem. Turning tick off again can't be seen once the engine tick
+ * is already off, so an object that wants to stop ticking for good should be unregistered.
+ */
+UCLASS(Config=Game)
+class LUNARROGUE_API ULunarFrameBudgetSubsystem : public UTickableWorldSubsystem
+{
+	GENERATED_BODY()
+public:
+	virtual void Initialize(FSubsystemCollectionBase& Collection) override;
+	virtual void Deinitialize() override;
+	virtual void OnWorldBeginPlay(UWorld& InWorld) override;
+	virtual void Tick(float DeltaTime) override;
+	virtual TStatId GetStatId() const override;
+
+	UFUNCTION(BlueprintCallable, Category="Lunar Budget")
+	void RegisterBudgetedObject(UObject* Object, ELunarBudgetCategory Category);
+	UFUNCTION(BlueprintCallable, Category="Lunar Budget")
+	void UnregisterBudgetedObject(UObject* Object);
+	UFUNCTION(BlueprintCallable, Category="Lunar Budget")
+	int32 GetBudgetLevel(ELunarBudgetCategory Category) const;
+	UFUNCTION(BlueprintCallable, Category="Lunar Budget")
+	float GetSmoothedCostMs(ELunarBudgetCategory Category) const;
+	UFUNCTION(BlueprintCallable, Category="Lunar Budget")
+	float GetSmoothedTotalMs() const;
+
+	void RegisterMovement(ULunarCharacterMovementComponent* Movement);
+	void UnregisterMovement(ULunarCharacterMovementComponent* Movement);
+	void AddCost(ELunarBudgetCategory Category, double Seconds);
+	void AddMovementCost(const ULunarCharacterMovementComponent* Movement, double Seconds);
+	void LogStatus() const;
+
+	// properties
+	UPROPERTY(Config, Category="Lunar Budget", EditAnywhere, BlueprintReadWrite)
+	bool bEnabled = true;
+	UPROPERTY(Config, Category="Lunar Budget", EditAnywhere, BlueprintReadWrite, meta=(ClampMin="0.1", UIMin="0.1"))
+	float TargetSimulationMs = 8;
+	// fraction of the target the estimated total has to stay under before a category is restored
+	UPROPERTY(Config, Category="Lunar Budget", EditAnywhere, BlueprintReadWrite, meta=(ClampMin="0", ClampMax="1", UIMin="0", UIMax="1"))
+	float RestoreThreshold = 0.9f;
+	UPROPERTY(Config, Category="Lunar Budget", EditAnywhere, BlueprintReadWrite, meta=(ClampMin="0", UIMin="0"))
+	float DecisionInterval = 0.5f;
+	// time constant of the cost smoothing in seconds, decisions wait at least five of these
+	UPROPERTY(Config, Category="Lunar Budget", EditAnywhere, BlueprintReadWrite, meta=(ClampMin="0.01", UIMin="0.01"))
+	float SmoothingTime = 0.1f;
+	// clamped to MaxSupportedBudgetLevel, the ClampMax only applies in the editor
+	UPROPERTY(Config, Category="Lunar Budget", EditAnywhere, BlueprintReadWrite, meta=(ClampMin="0", ClampMax="6", UIMin="0", UIMax="6"))
+	int32 MaxBudgetLevel = 3;
+
+protected:
+	virtual bool DoesSupportWorldType(const EWorldType::Type WorldType) const override;
+
+private:
+	// each level halves a batch or doubles a tick interval with a shift, keep it well inside an int32
+	static constexpr int32 MaxSupportedBudgetLevel = 6;
+
+	struct FMovementEntry
+	{
+		TWeakObjectPtr<ULunarCharacterMovementComponent> Movement;
+		int32 AppliedLevel = 0;
+		// what the component had before we first throttled it
+		int32 SavedMaxSimulationIterations = 0;
+		float SavedTickInterval = 0;
+	};
+
+	struct FBudgetedEntry
+	{
+		TWeakObjectPtr<UObject> Object;
+		double LastTickTime = 0;
+		float TickInterval = 0;
+		bool bTickEnabled = true;
+	};
+
+	struct FCategoryState
+	{
+		TArray<FBudgetedEntry> Entries;
+		int32 NextEntry = 0;
+		int32 Level = 0;
+		double FrameCost = 0;
+		double SmoothedCost = 0;
+		// the part of the cost a higher level can cut, decisions are made on this
+		double FrameThrottleableCost = 0;
+		double SmoothedThrottleableCost = 0;
+	};
+
+	void HandleActorSpawned(AActor* Actor);
+	void RegisterIfTicking(UObject* Object, ELunarBudgetCategory Category);
+	void TickBudgetedEntries(FCategoryState& State);
+	void Evaluate();
+	void ApplyMovementLevels();
+	void ApplyMovementLevel(FMovementEntry& Entry, int32 NewLevel) const;
+	static void RestoreEngineTick(const FBudgetedEntry& Entry);
+	static bool CanThrottleMovement(const ULunarCharacterMovementComponent* Movement);
+
+	TArray<FMovementEntry> MovementEntries;
+	FCategoryState Categories[(int32)ELunarBudgetCategory::MAX];
+	double SmoothedTotal = 0;
+	double SmoothedFrameTime = 0;
+	double TimeSinceDecision = 0;
+	FDelegateHandle ActorSpawnedHandle;
+};
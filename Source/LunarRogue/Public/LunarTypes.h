@@ -10,3 +10,12 @@ enum LunarMovementMode : int
 	CMOVE_Slide				UMETA(DisplayName="Slide"),
 	CMOVE_AirSlide			UMETA(DisplayName="Aerial Slide"),
 };
+
+UENUM(BlueprintType)
+enum class ELunarBudgetCategory : uint8
+{
+	Movement				UMETA(DisplayName="Movement"),
+	AI						UMETA(DisplayName="AI"),
+	Projectiles				UMETA(DisplayName="Projectiles"),
+	MAX						UMETA(Hidden),
+};